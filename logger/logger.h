@@ -16,7 +16,17 @@
 #include <tuple>
 #include <ctime>
 #include <optional>
+#include <array>
+#include <cstring>
+#include <cstdint>
+#include <iterator>
+#include <compare>
+#include <span>
+#include <string_view>
+#include <charconv>
 #include "source_location.h"
+#include "lz_codec.h"
+#include "transcode.h"
 
 namespace bits
 {
@@ -51,9 +61,10 @@ namespace bits
 
     using clock_type = ClockType;
     using string_type = std::basic_string<CharType, Traits, StringAllocator>;
+    using string_view_type = std::basic_string_view<CharType, Traits>;
     using time_point_type = std::chrono::time_point<ClockType>;
     using entry_type = std::tuple<string_type, log_level, time_point_type>;
-    using buffer_type = std::vector<entry_type>;
+    using buffer_type = std::vector<entry_type, Allocator>;
     using traits_type = Traits;
     using value_type = CharType;
     using allocator_type = Allocator;
@@ -61,16 +72,142 @@ namespace bits
     using difference_type = typename std::allocator_traits<Allocator>::difference_type;
     using pointer = typename std::allocator_traits<Allocator>::pointer;
     using const_pointer = typename std::allocator_traits<Allocator>::const_pointer;
-    using iterator = typename buffer_type::iterator;
-    using const_iterator = typename buffer_type::const_iterator;
+
+    /* entries in sealed segments only exist in compressed form, so iterators
+       produce entries by value (decompressing the segment on demand) rather
+       than handing out references into the storage */
+    class const_iterator
+    {
+    public:
+      using iterator_concept = std::random_access_iterator_tag;
+      using iterator_category = std::input_iterator_tag;
+      using value_type = entry_type;
+      using difference_type = typename basic_in_memory_storage::difference_type;
+      using reference = entry_type;
+      using pointer = void;
+
+      const_iterator() = default;
+
+      entry_type operator*() const
+      {
+	return m_storage->entry_at(m_index);
+      }
+
+      entry_type operator[](difference_type n) const
+      {
+	return *(*this + n);
+      }
+
+      const_iterator& operator++() noexcept
+      {
+	++m_index;
+	return *this;
+      }
+
+      const_iterator operator++(int) noexcept
+      {
+	auto tmp = *this;
+	++m_index;
+	return tmp;
+      }
+
+      const_iterator& operator--() noexcept
+      {
+	--m_index;
+	return *this;
+      }
+
+      const_iterator operator--(int) noexcept
+      {
+	auto tmp = *this;
+	--m_index;
+	return tmp;
+      }
+
+      const_iterator& operator+=(difference_type n) noexcept
+      {
+	m_index += n;
+	return *this;
+      }
+
+      const_iterator& operator-=(difference_type n) noexcept
+      {
+	m_index -= n;
+	return *this;
+      }
+
+      friend const_iterator operator+(const_iterator it, difference_type n) noexcept
+      {
+	return it += n;
+      }
+
+      friend const_iterator operator+(difference_type n, const_iterator it) noexcept
+      {
+	return it += n;
+      }
+
+      friend const_iterator operator-(const_iterator it, difference_type n) noexcept
+      {
+	return it -= n;
+      }
+
+      friend difference_type operator-(const const_iterator& a,
+				       const const_iterator& b) noexcept
+      {
+	return static_cast<difference_type>(a.m_index)
+	  - static_cast<difference_type>(b.m_index);
+      }
+
+      friend bool operator==(const const_iterator&, const const_iterator&) = default;
+
+      friend auto operator<=>(const const_iterator& a,
+			      const const_iterator& b) noexcept
+      {
+	return a.m_index <=> b.m_index;
+      }
+
+    private:
+      friend class basic_in_memory_storage;
+
+      const_iterator(const basic_in_memory_storage *storage, size_type index) noexcept
+	: m_storage{storage},
+	  m_index{index}
+      {}
+
+      const basic_in_memory_storage *m_storage = nullptr;
+      size_type m_index = 0;
+    };
+
+    using iterator = const_iterator;
     using reverse_iterator = std::reverse_iterator<iterator>;
     using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+    /* number of entries sealed into each compressed segment */
+    static constexpr size_type default_segment_entries = 128;
+    /* number of decompressed segments kept around for iteration and read() */
+    static constexpr size_type segment_cache_slots = 4;
+    /* on its first write, the active segment preallocates this many
+       characters per entry, for the call-site prefix as well as the
+       message. Entries are packed into it back to back, so a long entry only
+       goes to the overflow area once the shorter ones before it have used up
+       the whole segment's share. Pass a different value to the constructor
+       (and the storage to basic_logger::set_backing()) to size it for
+       longer or shorter entries. */
+    static constexpr size_type default_inline_chars = 160;
     
     basic_in_memory_storage() = default;
     
-    basic_in_memory_storage(size_type buf_size)
-      : m_buffer{buf_size}
-    {}
+    basic_in_memory_storage(size_type buf_size,
+			    size_type segment_entries = default_segment_entries,
+			    size_type inline_chars = default_inline_chars)
+      : m_segment_entries{segment_entries},
+	m_inline_chars{inline_chars}
+    {
+      if (segment_entries == 0) {
+	throw std::invalid_argument("basic_in_memory_storage: segment_entries must be nonzero");
+      }
+      reserve(buf_size);
+    }
 
     basic_in_memory_storage(const basic_in_memory_storage<CharType, Traits,
 			    ClockType, DurationType, StringAllocator, Allocator>&) = default;
@@ -78,17 +215,63 @@ namespace bits
 			    ClockType, DurationType, StringAllocator, Allocator> && ) = default;
 
 
-    basic_in_memory_storage& write(const string_type& string, log_level level,
+    basic_in_memory_storage& write(string_view_type string, log_level level,
 				   const time_point_type& time)
     {
-      m_buffer.push_back({string, level, time});
-      return *this;
+      return write_concatenated(std::span<const string_view_type>(&string, 1),
+				level, time);
     }
 
-    basic_in_memory_storage& write(const value_type *string, log_level level,
-				   const time_point_type& time)
+    /* writes a single entry made of `parts` joined together, without
+       building the joined string first. This does not allocate unless the
+       active segment's text runs past segment_entries() * inline_chars()
+       characters and the overflow area has to grow, or
+       the active segment fills up and is sealed; sealing allocates the
+       compressed segment and occasionally grows the list of segments. */
+    basic_in_memory_storage& write_concatenated(std::span<const string_view_type> parts,
+						log_level level,
+						const time_point_type& time)
     {
-      m_buffer.push_back({string_type(string), level, time});
+      if (m_inline.empty()) {
+	allocate_active();
+      }
+      size_type length = 0;
+      for (const auto& part : parts) {
+	length += part.size();
+      }
+      entry_slot slot{level, time, length, 0, false};
+      value_type *dest;
+      if (length <= m_inline.size() - m_inline_used) {
+	slot.offset = m_inline_used;
+	dest = m_inline.data() + slot.offset;
+      } else {
+	slot.offset = m_overflow.size();
+	slot.overflow = true;
+	m_overflow.resize(m_overflow.size() + length);
+	dest = m_overflow.data() + slot.offset;
+      }
+      for (const auto& part : parts) {
+	traits_type::copy(dest, part.data(), part.size());
+	dest += part.size();
+      }
+      m_slots.push_back(slot);
+      if (not slot.overflow) {
+	m_inline_used += length;
+      }
+      /* a segment always holds exactly m_segment_entries entries, so if
+	 sealing fails, take the entry back out rather than leaving a full
+	 active segment for the next write to overfill */
+      try {
+	seal_if_full();
+      } catch (...) {
+	m_slots.pop_back();
+	if (slot.overflow) {
+	  m_overflow.resize(slot.offset);
+	} else {
+	  m_inline_used = slot.offset;
+	}
+	throw;
+      }
       return *this;
     }
 
@@ -106,6 +289,15 @@ namespace bits
       return formatted(string_type(message), level, time);
     }
 
+    /* like formatted_entry(), but appends to `out` so a caller that formats
+       many entries can reuse one buffer */
+    void append_formatted_entry(string_type& out, string_view_type message,
+				log_level level,
+				const time_point_type& time) const
+    {
+      append_formatted(out, message, level, time);
+    }
+
     string_type read(log_level minlevel = log_level::NOTSET) const noexcept
     {
       return read(0, minlevel);
@@ -126,14 +318,19 @@ namespace bits
       }
       size_type i=start, N=std::min(size(), start+nentry);
       for(; i<N-1; ++i) {
-	if (std::get<1>(m_buffer[i]) >= minlevel) {
-	  result += formatted(std::get<0>(m_buffer[i]), std::get<1>(m_buffer[i]), std::get<2>(m_buffer[i]));
+	auto entry = entry_at(i);
+	if (std::get<1>(entry) >= minlevel) {
+	  append_formatted(result, std::get<0>(entry), std::get<1>(entry), std::get<2>(entry));
 	  result += newline();
 	}
       }
-      if (std::get<1>(m_buffer[N-1]) >= minlevel) {
-	result += formatted(std::get<0>(m_buffer[N-1]), std::get<1>(m_buffer[N-1]), std::get<2>(m_buffer[N-1]));
+      auto last = entry_at(N-1);
+      if (std::get<1>(last) >= minlevel) {
+	append_formatted(result, std::get<0>(last), std::get<1>(last), std::get<2>(last));
       }
+      /* read() is usually a one-off pass over the whole log, so don't keep
+	 the segments it decompressed resident afterwards */
+      release_cache();
       return result;
     }
 
@@ -154,67 +351,67 @@ namespace bits
 
     constexpr iterator begin() noexcept
     {
-      return m_buffer.begin();
+      return cbegin();
     }
     
     constexpr const_iterator begin() const noexcept
     {
-      return m_buffer.begin();
+      return cbegin();
     }
     
     constexpr const_iterator cbegin() const noexcept
     {
-      return m_buffer.cbegin();
+      return const_iterator(this, 0);
     }
 
     constexpr iterator end() noexcept
     {
-      return m_buffer.end();
+      return cend();
     }
 
     constexpr const_iterator end() const noexcept
     {
-      return m_buffer.end();
+      return cend();
     }
 
     constexpr const_iterator cend() const noexcept
     {
-      return m_buffer.cend();
+      return const_iterator(this, size());
     }
 
     constexpr reverse_iterator rbegin() noexcept
     {
-      return m_buffer.rbegin();
+      return crbegin();
     }
     
     constexpr const_reverse_iterator rbegin() const noexcept
     {
-      return m_buffer.rbegin();
+      return crbegin();
     }
     
     constexpr const_reverse_iterator crbegin() const noexcept
     {
-      return m_buffer.crbegin();
+      return const_reverse_iterator(cend());
     }
 
     constexpr reverse_iterator rend() noexcept
     {
-      return m_buffer.rend();
+      return crend();
     }
 
     constexpr const_reverse_iterator crend() const noexcept
     {
-      return m_buffer.crend();
+      return const_reverse_iterator(cbegin());
     }
 
     [[nodiscard]] constexpr bool empty() const noexcept
     {
-      return m_buffer.empty();
+      return size() == 0;
     }
 
     constexpr size_type size() const noexcept
     {
-      return m_buffer.size();
+      return m_sealed.size() * m_segment_entries + m_slots.size();
     }
 
     constexpr size_type num_entries() const noexcept
@@ -222,25 +419,84 @@ namespace bits
       return size();
     }
 
-    /* returns size in bytes of the whole buffer */
+    /* returns size in bytes of all the messages in the buffer, as if they
+       were stored uncompressed */
     constexpr size_type buffer_size() const noexcept
     {
       /* should we check for overflow? not doing that right now */
       size_type size = 0;
-      for (const auto& entry : m_buffer) {
-	size += sizeof(value_type) * entry.size();
+      for (const auto& segment : m_sealed) {
+	size += segment.message_bytes;
+      }
+      for (const auto& slot : m_slots) {
+	size += sizeof(value_type) * slot.length;
       }
       return size;
     }
 
+    /* returns the number of bytes the buffer actually holds on to: the 
+       compressed sealed segments, the uncompressed active segment, and
+       whatever is currently in the decompressed-segment cache */
+    size_type resident_size() const noexcept
+    {
+      size_type size = 0;
+      for (const auto& segment : m_sealed) {
+	size += segment.data.capacity();
+      }
+      size += sizeof(entry_slot) * m_slots.capacity();
+      size += sizeof(value_type) * (m_inline.capacity() + m_overflow.capacity());
+      size += m_scratch.capacity() + m_compressed.capacity();
+      std::lock_guard<std::mutex> lock(m_cache_mutex.mutex);
+      for (const auto& slot : m_cache) {
+	size += sizeof(entry_type) * slot.entries.capacity();
+	for (const auto& entry : slot.entries) {
+	  size += sizeof(value_type) * std::get<0>(entry).capacity();
+	}
+      }
+      size += m_unpacked.capacity();
+      return size;
+    }
+
+    /* frees the decompressed-segment cache; iteration refills it on demand */
+    void release_cache() const noexcept
+    {
+      std::lock_guard<std::mutex> lock(m_cache_mutex.mutex);
+      for (auto& slot : m_cache) {
+	slot.index = no_segment;
+	buffer_type{}.swap(slot.entries);
+      }
+      std::vector<unsigned char>{}.swap(m_unpacked);
+    }
+
+    constexpr size_type segment_entries() const noexcept
+    {
+      return m_segment_entries;
+    }
+
+    constexpr size_type num_sealed_segments() const noexcept
+    {
+      return m_sealed.size();
+    }
+
+    /* characters per entry preallocated for the active segment */
+    constexpr size_type inline_chars() const noexcept
+    {
+      return m_inline_chars;
+    }
+
+    /* the active segment is always allocated at its full size, so reserving
+       only adds room for the compressed segments beyond that */
     constexpr void reserve(size_type new_capacity)
     {
-      m_buffer.reserve(new_capacity);
+      if (m_inline.empty()) {
+	allocate_active();
+      }
+      m_sealed.reserve(new_capacity / m_segment_entries);
     }
 
     constexpr size_type capacity() const noexcept
     {
-      return m_buffer.capacity();
+      return m_sealed.capacity() * m_segment_entries + m_slots.capacity();
     }
 
     static constexpr string_type new_line() noexcept
@@ -248,26 +504,263 @@ namespace bits
       return newline();
     }
 
-    constexpr void clear() const noexcept
+    void clear() noexcept
     {
-      m_buffer.clear();
+      m_slots.clear();
+      m_inline_used = 0;
+      m_overflow.clear();
+      m_sealed.clear();
+      release_cache();
     }
 
     static constexpr string_type get_level_name(log_level level) noexcept
+    {
+      return string_type(level_name(level));
+    }
+
+    /* same as get_level_name(), but refers to a string literal instead of
+       building a string */
+    static constexpr string_view_type get_level_name_view(log_level level) noexcept
     {
       return level_name(level);
     }
     
 
   private:
-    std::vector<std::tuple<
-		  string_type,
-		  log_level,
-		  time_point_type
-		  >
-		> m_buffer;
+    struct sealed_segment
+    {
+      std::vector<unsigned char> data;
+      size_type raw_bytes;
+      size_type message_bytes;
+    };
+
+    struct cached_segment
+    {
+      size_type index = no_segment;
+      buffer_type entries;
+    };
 
-    static constexpr string_type level_name(log_level level) noexcept
+    /* const member functions fill the decompressed-segment cache, so it is
+       guarded to keep concurrent reads safe. Copies of the storage get a
+       mutex of their own. */
+    struct cache_mutex
+    {
+      std::mutex mutex;
+
+      cache_mutex() = default;
+      cache_mutex(const cache_mutex&) noexcept {}
+      cache_mutex& operator=(const cache_mutex&) noexcept { return *this; }
+    };
+
+    /* an entry in the active segment; its text starts at `offset` in
+       m_inline or, if `overflow` is set, in m_overflow */
+    struct entry_slot
+    {
+      log_level level;
+      time_point_type time;
+      size_type length;
+      size_type offset;
+      bool overflow;
+    };
+
+    static constexpr size_type no_segment = static_cast<size_type>(-1);
+
+    size_type m_segment_entries = default_segment_entries;
+    size_type m_inline_chars = default_inline_chars;
+    /* the most recent entries, kept uncompressed so that appends are cheap.
+       m_inline holds m_segment_entries * m_inline_chars characters, of which
+       the first m_inline_used are taken; like m_slots, it is allocated once
+       and reused after sealing */
+    std::vector<entry_slot> m_slots;
+    std::vector<value_type, StringAllocator> m_inline;
+    size_type m_inline_used = 0;
+    std::vector<value_type, StringAllocator> m_overflow;
+    /* older entries, m_segment_entries at a time, serialized and compressed */
+    std::vector<sealed_segment> m_sealed;
+    /* reused for serializing segments and compressing them */
+    std::vector<unsigned char> m_scratch;
+    std::vector<unsigned char> m_compressed;
+    /* the cache and the buffer segments are decompressed into are only
+       touched with m_cache_mutex held */
+    mutable cache_mutex m_cache_mutex;
+    mutable std::array<cached_segment, segment_cache_slots> m_cache;
+    mutable size_type m_cache_next = 0;
+    mutable std::vector<unsigned char> m_unpacked;
+
+    using tick_type = typename time_point_type::duration::rep;
+
+    void allocate_active()
+    {
+      m_slots.reserve(m_segment_entries);
+      m_inline.resize(m_segment_entries * m_inline_chars);
+    }
+
+    string_view_type slot_text(size_type i) const noexcept
+    {
+      const auto& slot = m_slots[i];
+      const auto& text = slot.overflow ? m_overflow : m_inline;
+      return string_view_type(text.data() + slot.offset, slot.length);
+    }
+
+    entry_type entry_at(size_type i) const
+    {
+      size_type nsealed = m_sealed.size() * m_segment_entries;
+      if (i < nsealed) {
+	std::lock_guard<std::mutex> lock(m_cache_mutex.mutex);
+	return segment(i / m_segment_entries)[i % m_segment_entries];
+      }
+      i -= nsealed;
+      return {string_type(slot_text(i)), m_slots[i].level, m_slots[i].time};
+    }
+
+    /* must be called with m_cache_mutex held */
+    const buffer_type& segment(size_type index) const
+    {
+      for (const auto& slot : m_cache) {
+	if (slot.index == index) {
+	  return slot.entries;
+	}
+      }
+      auto& slot = m_cache[m_cache_next];
+      m_cache_next = (m_cache_next + 1) % segment_cache_slots;
+      slot.index = no_segment;
+      slot.entries.clear();
+
+      const auto& sealed = m_sealed[index];
+      m_unpacked.resize(sealed.raw_bytes);
+      lz::decompress(sealed.data.data(), sealed.data.size(),
+		     m_unpacked.data(), m_unpacked.size());
+      /* the segment is laid out as all the entry headers followed by all the
+	 message text, which keeps the repetitive text together for the codec */
+      const unsigned char *p = m_unpacked.data();
+      std::vector<std::tuple<size_type, log_level, tick_type>> headers;
+      headers.reserve(m_segment_entries);
+      tick_type previous{};
+      for (size_type i = 0; i < m_segment_entries; ++i) {
+	auto len = get_varint(p);
+	auto level = static_cast<log_level>(static_cast<int>(get_varint(p)));
+	previous = get_ticks(p, previous);
+	headers.push_back({len, level, previous});
+      }
+      slot.entries.reserve(m_segment_entries);
+      for (const auto& [len, level, ticks] : headers) {
+	string_type message(len, value_type{});
+	std::memcpy(message.data(), p, len * sizeof(value_type));
+	p += len * sizeof(value_type);
+	slot.entries.push_back({std::move(message), level,
+	    time_point_type{typename time_point_type::duration{ticks}}});
+      }
+      slot.index = index;
+      return slot.entries;
+    }
+
+    void seal_if_full()
+    {
+      if (m_slots.size() < m_segment_entries) {
+	return;
+      }
+      m_scratch.clear();
+      size_type message_bytes = 0;
+      tick_type previous{};
+      for (const auto& slot : m_slots) {
+	put_varint(slot.length);
+	put_varint(static_cast<unsigned>(static_cast<int>(slot.level)));
+	tick_type ticks = slot.time.time_since_epoch().count();
+	put_ticks(ticks, previous);
+	previous = ticks;
+	message_bytes += slot.length * sizeof(value_type);
+      }
+      for (size_type i = 0; i < m_slots.size(); ++i) {
+	auto message = slot_text(i);
+	put_bytes(message.data(), message.size() * sizeof(value_type));
+      }
+      /* compress into a reused buffer sized for the worst case, so the
+	 only allocation a seal makes is the compressed segment itself (plus
+	 the occasional growth of m_sealed) */
+      m_compressed.clear();
+      m_compressed.reserve(m_scratch.size() + m_scratch.size() / 255 + 16);
+      lz::compress(m_scratch.data(), m_scratch.size(), m_compressed);
+      m_sealed.push_back({std::vector<unsigned char>(m_compressed.begin(),
+						     m_compressed.end()),
+			  m_scratch.size(), message_bytes});
+      m_slots.clear();
+      m_inline_used = 0;
+      m_overflow.clear();
+      release_oversized_buffers();
+    }
+
+    /* the reused buffers grow to fit the largest segment seen so far; once
+       an unusually large one has been sealed, give that memory back rather
+       than holding on to it for the rest of the log */
+    void release_oversized_buffers() noexcept
+    {
+      size_type budget = m_segment_entries * m_inline_chars;
+      size_type budget_bytes = 2 * budget * sizeof(value_type);
+      if (m_overflow.capacity() > budget) {
+	decltype(m_overflow){}.swap(m_overflow);
+      }
+      if (m_scratch.capacity() > budget_bytes) {
+	std::vector<unsigned char>{}.swap(m_scratch);
+      }
+      if (m_compressed.capacity() > budget_bytes) {
+	std::vector<unsigned char>{}.swap(m_compressed);
+      }
+    }
+
+    void put_bytes(const void *data, std::size_t n)
+    {
+      auto bytes = static_cast<const unsigned char *>(data);
+      m_scratch.insert(m_scratch.end(), bytes, bytes + n);
+    }
+
+    void put_varint(std::uint64_t v)
+    {
+      while (v >= 0x80) {
+	m_scratch.push_back(static_cast<unsigned char>(v | 0x80));
+	v >>= 7;
+      }
+      m_scratch.push_back(static_cast<unsigned char>(v));
+    }
+
+    /* integral timestamps are stored as zigzag-encoded deltas from the
+       previous entry, which is usually only a few bytes */
+    void put_ticks(tick_type ticks, tick_type previous)
+    {
+      if constexpr (std::is_integral_v<tick_type>) {
+	auto delta = static_cast<std::int64_t>(ticks) - static_cast<std::int64_t>(previous);
+	put_varint((static_cast<std::uint64_t>(delta) << 1) ^ static_cast<std::uint64_t>(delta >> 63));
+      } else {
+	put_bytes(&ticks, sizeof(ticks));
+      }
+    }
+
+    static tick_type get_ticks(const unsigned char *& p, tick_type previous) noexcept
+    {
+      if constexpr (std::is_integral_v<tick_type>) {
+	auto zigzag = get_varint(p);
+	auto delta = static_cast<std::int64_t>(zigzag >> 1) ^ -static_cast<std::int64_t>(zigzag & 1);
+	return static_cast<tick_type>(static_cast<std::int64_t>(previous) + delta);
+      } else {
+	tick_type ticks;
+	std::memcpy(&ticks, p, sizeof(ticks));
+	p += sizeof(ticks);
+	return ticks;
+      }
+    }
+
+    static std::uint64_t get_varint(const unsigned char *& p) noexcept
+    {
+      std::uint64_t v = 0;
+      for (unsigned shift = 0; ; shift += 7) {
+	unsigned char b = *p++;
+	v |= std::uint64_t{b & 0x7fu} << shift;
+	if (not (b & 0x80)) {
+	  return v;
+	}
+      }
+    }
+
+    static constexpr string_view_type level_name(log_level level) noexcept
     {
       if constexpr (std::is_same<value_type, char>::value) {
 	switch (level) {
@@ -362,32 +855,27 @@ namespace bits
       }
     }
 
-    virtual string_type formatted(const string_type& val, log_level level, const time_point_type& time) const 
+    string_type formatted(string_view_type val, log_level level, const time_point_type& time) const
+    {
+      string_type result;
+      append_formatted(result, val, level, time);
+      return result;
+    }
+
+    /* appends `val` followed by its timestamp to `out` */
+    virtual void append_formatted(string_type& out, string_view_type val, log_level level, const time_point_type& time) const
     {
       char tbuf[100]; /* assume a timestamp is < 100 characters */
       auto now = ClockType::to_time_t(time);
       std::tm *now_tm = std::localtime(&now);
-      std::string ctime;
-      if (auto len = strftime(tbuf, sizeof(tbuf), "%c", now_tm)) {
-	ctime = std::string{tbuf, len};
-      } else {
+      auto len = strftime(tbuf, sizeof(tbuf), "%c", now_tm);
+      if (not len) {
 	throw std::runtime_error("strftime failed");
       }
-      
-      if constexpr (std::is_same<value_type, char>::value) {
-	return val + " " + ctime;
-      } else if constexpr (std::is_same<value_type, wchar_t>::value) {
-	return val + L" "
-	  + std::wstring(ctime.begin(), ctime.end());;
-      } else if constexpr (std::is_same<value_type, char8_t>::value) {
-	return val + u8" " + 
-	  std::u8string(ctime.begin(), ctime.end());
-      } else if constexpr (std::is_same<value_type, char16_t>::value) {
-	return val + u" " + std::u16string(ctime.begin(), ctime.end());
-      } else if constexpr (std::is_same<value_type, char32_t>::value) {
-	return val + U" " + 
-	  std::u32string(ctime.begin(), ctime.end());
-      } 
+      out.reserve(out.size() + val.size() + 1 + len);
+      out += val;
+      out += value_type(' ');
+      transcode::append_utf8(out, std::string_view(tbuf, len));
     }
     
   };
@@ -414,14 +902,18 @@ namespace bits
     /* a shared pointer because we can create sub-loggers that share the same backing
        (i.e. write to/read from the same log) */
     std::shared_ptr<Storage> m_backing;
-    bool         m_has_ostream, m_preserve_all;
-    OutputStream &m_os;
+    bool         m_has_ostream = false, m_preserve_all = false;
+    /* null when the logger has no stream to display entries on */
+    OutputStream *m_os = nullptr;
     typename Storage::string_type m_name;
+    /* reused by write_entry() to join and format entries for display, so
+       showing an entry doesn't allocate once they have grown to fit */
+    typename Storage::string_type m_message, m_display;
 
     /* private ctor to create sub-loggers because the public API for that is
        the get_sublogger() member function */
     basic_logger(std::shared_ptr<Storage> backing, bool has_ostream,
-		 bool preserve_all, OutputStream& os, log_level level,
+		 bool preserve_all, OutputStream *os, log_level level,
 		 typename Storage::string_type parent_name,
 		 typename Storage::string_type child_name)
       : m_level{level},
@@ -429,8 +921,28 @@ namespace bits
 	m_has_ostream{has_ostream},
 	m_preserve_all{preserve_all},
 	m_os{os},
-	m_name{parent_name + typename Storage::string_type(":") + child_name}
-    {}
+	m_name{parent_name}
+    {
+      m_name += CharType(':');
+      m_name += child_name;
+    }
+
+    /* writes `parts` joined together as one entry */
+    void write_entry(std::span<const typename Storage::string_view_type> parts,
+		     log_level level,
+		     const typename Storage::time_point_type& time, bool display)
+    {
+      m_backing->write_concatenated(parts, level, time);
+      if (display and m_has_ostream and level >= m_level) {
+	m_message.clear();
+	for (const auto& part : parts) {
+	  m_message += part;
+	}
+	m_display.clear();
+	m_backing->append_formatted_entry(m_display, m_message, level, time);
+	*m_os << m_display << m_backing->new_line();
+      }
+    }
 	
 		 
   public:
@@ -441,6 +953,7 @@ namespace bits
     using size_type = typename Storage::size_type;
     using char_type = CharType;
     using string_type = typename Storage::string_type;
+    using string_view_type = typename Storage::string_view_type;
     using iterator = typename Storage::iterator;
     using const_iterator = typename Storage::const_iterator;
     using reverse_iterator = typename Storage::reverse_iterator;
@@ -454,7 +967,7 @@ namespace bits
     basic_logger(typename std::enable_if_t<std::is_same_v<T, char>,
 		 OutputStream&> os = std::clog,
 		 log_level llevel = log_level::NOTSET)
-      : m_os{os},
+      : m_os{&os},
 	m_level{llevel},
 	m_has_ostream{true}
     {
@@ -465,20 +978,34 @@ namespace bits
     basic_logger(typename std::enable_if_t<std::is_same_v<T, wchar_t>,
 		 OutputStream&> os = std::wclog,
 		 log_level llevel = log_level::NOTSET)
-      : m_os{os},
+      : m_os{&os},
 	m_level{llevel},
 	m_has_ostream{true}
     {
       m_backing = std::make_shared<Storage>();
     }
 
-    template<typename T>
-    basic_logger(std::optional<OutputStream> os = std::nullopt, log_level newlevel = log_level::NOTSET)
+    /* there are no standard streams for char8_t, char16_t or char32_t, so
+       loggers of those types only display entries if given a stream */
+    template<typename T = char_type>
+    basic_logger(typename std::enable_if_t<not std::is_same_v<T, char>
+		 and not std::is_same_v<T, wchar_t>,
+		 log_level> llevel = log_level::NOTSET)
+      : m_level{llevel}
     {
-      if (os) {
-	m_os = *os;
-      }
-      m_level = newlevel;
+      m_backing = std::make_shared<Storage>();
+    }
+
+    template<typename T = char_type>
+    basic_logger(typename std::enable_if_t<not std::is_same_v<T, char>
+		 and not std::is_same_v<T, wchar_t>,
+		 OutputStream&> os,
+		 log_level llevel = log_level::NOTSET)
+      : m_level{llevel},
+	m_has_ostream{true},
+	m_os{&os}
+    {
+      m_backing = std::make_shared<Storage>();
     }
 
     basic_logger& set_name(string_type name) noexcept
@@ -487,6 +1014,15 @@ namespace bits
       return *this;
     }
 
+    /* replaces the log this logger writes to, e.g. with a storage built with
+       non-default segment_entries or inline_chars. Subloggers made before
+       this call keep writing to the old log. */
+    basic_logger& set_backing(std::shared_ptr<Storage> backing) noexcept
+    {
+      m_backing = std::move(backing);
+      return *this;
+    }
+
     basic_logger& set_level(log_level newlevel) noexcept
     {
       m_level = newlevel;
@@ -520,26 +1056,34 @@ namespace bits
     }
 
     
-    basic_logger& log(string_type message, log_level level,
+    /* the prefix and message are written straight into the backing storage,
+       so a call that isn't displayed does not allocate (see
+       basic_in_memory_storage::write_concatenated()). For non-char loggers
+       the file and function names are converted on the first call from each
+       call site and reused after that. */
+    basic_logger& log(string_view_type message, log_level level,
 		      bool display=true,
 		      source_location where = source_location::current())
     {
       if (level < m_level and not m_preserve_all) {
 	return *this;
       }
+      static constexpr auto open = transcode::literal<char_type>("[");
+      static constexpr auto colon = transcode::literal<char_type>(":");
+      static constexpr auto in_function = transcode::literal<char_type>("] (in function ");
+      static constexpr auto close = transcode::literal<char_type>(") ");
       auto time = clock_type::now();
-      string_type prefix = string_type("[") +
-	string_type(where.file_name()) + string_type(":") +
-	string_type(std::to_string(where.line())) + string_type("]") +
-	string_type(" (in function ") + string_type(where.function_name()) +
-	string_type(") ") + m_backing->get_level_name(level) +
-	string_type(":") + m_name + string_type(":");
-      message = prefix + message;
-      m_backing->write(message, level, time);
-      if (display and level >= m_level) {
-	m_os << m_backing->formatted_entry(message, level, time)
-	     << m_backing->new_line();
-      }
+      char digits[16];
+      auto digits_end = std::to_chars(digits, digits + sizeof(digits), where.line()).ptr;
+      char_type line[sizeof(digits)];
+      auto nline = transcode::widen_ascii(digits, digits_end - digits, line);
+      const std::array<string_view_type, 12> parts{
+	open, transcode::call_site<string_type>(where.file_name()), colon,
+	string_view_type(line, nline), in_function,
+	transcode::call_site<string_type>(where.function_name()), close,
+	m_backing->get_level_name_view(level), colon, m_name, colon, message
+      };
+      write_entry(parts, level, time, display);
       return *this;
     }
 
@@ -0,0 +1,176 @@
+#ifndef BITS_LZ_CODEC_H
+#define BITS_LZ_CODEC_H
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <array>
+#include <vector>
+#include <stdexcept>
+
+namespace bits
+{
+  /* a small self-contained LZ77 block codec that produces (and consumes) the
+     LZ4 block format: a sequence of [token][literals][offset][match length]
+     records. It trades ratio for speed, which is what we want for compressing
+     log segments that are written once and read rarely. */
+  namespace lz
+  {
+    namespace detail
+    {
+      inline constexpr std::size_t min_match = 4;
+      /* per the LZ4 block format, the last match must start at least 12 bytes
+	 before the end of the block and the last 5 bytes are always literals */
+      inline constexpr std::size_t match_limit = 12;
+      inline constexpr std::size_t last_literals = 5;
+      inline constexpr std::size_t max_offset = 65535;
+      inline constexpr unsigned hash_log = 12;
+
+      inline std::uint32_t read32(const unsigned char *p) noexcept
+      {
+	std::uint32_t v;
+	std::memcpy(&v, p, sizeof(v));
+	return v;
+      }
+
+      inline std::uint32_t hash(std::uint32_t v) noexcept
+      {
+	return (v * 2654435761u) >> (32 - hash_log);
+      }
+
+      inline void write_length(std::vector<unsigned char>& out, std::size_t len)
+      {
+	while (len >= 255) {
+	  out.push_back(255);
+	  len -= 255;
+	}
+	out.push_back(static_cast<unsigned char>(len));
+      }
+
+      inline void write_sequence(std::vector<unsigned char>& out,
+				 const unsigned char *literals,
+				 std::size_t nliteral,
+				 std::size_t offset,
+				 std::size_t match_len)
+      {
+	/* match_len == 0 marks the final, literals-only sequence */
+	std::size_t mlen = match_len ? match_len - min_match : 0;
+	unsigned char token = static_cast<unsigned char>(
+	  ((nliteral < 15 ? nliteral : 15) << 4) | (mlen < 15 ? mlen : 15));
+	out.push_back(token);
+	if (nliteral >= 15) {
+	  write_length(out, nliteral - 15);
+	}
+	out.insert(out.end(), literals, literals + nliteral);
+	if (match_len) {
+	  out.push_back(static_cast<unsigned char>(offset & 0xff));
+	  out.push_back(static_cast<unsigned char>(offset >> 8));
+	  if (mlen >= 15) {
+	    write_length(out, mlen - 15);
+	  }
+	}
+      }
+
+      inline std::size_t read_length(const unsigned char *& ip,
+				     const unsigned char *end)
+      {
+	std::size_t len = 0;
+	unsigned char b;
+	do {
+	  if (ip == end) {
+	    throw std::runtime_error("lz::decompress: truncated length");
+	  }
+	  b = *ip++;
+	  len += b;
+	} while (b == 255);
+	return len;
+      }
+    } /* namespace detail */
+
+    /* appends the compressed form of [src, src+n) to `out` */
+    inline void compress(const unsigned char *src, std::size_t n,
+			 std::vector<unsigned char>& out)
+    {
+      using namespace detail;
+      std::size_t anchor = 0;
+      if (n >= match_limit + 1) {
+	/* positions are stored +1 so that 0 means "empty" */
+	std::array<std::uint32_t, std::size_t{1} << hash_log> table{};
+	const std::size_t limit = n - match_limit;
+	std::size_t ip = 0;
+	while (ip < limit) {
+	  std::uint32_t seq = read32(src + ip);
+	  std::uint32_t h = hash(seq);
+	  std::size_t ref = table[h];
+	  table[h] = static_cast<std::uint32_t>(ip + 1);
+	  if (ref == 0 or ip - (ref - 1) > max_offset
+	      or read32(src + ref - 1) != seq) {
+	    ++ip;
+	    continue;
+	  }
+	  --ref;
+	  std::size_t len = min_match;
+	  while (ip + len < n - last_literals and src[ref + len] == src[ip + len]) {
+	    ++len;
+	  }
+	  write_sequence(out, src + anchor, ip - anchor, ip - ref, len);
+	  ip += len;
+	  anchor = ip;
+	}
+      }
+      write_sequence(out, src + anchor, n - anchor, 0, 0);
+    }
+
+    /* decompresses [src, src+n) into exactly `dstn` bytes at `dst`; throws
+       std::runtime_error if the input is malformed or the sizes disagree */
+    inline void decompress(const unsigned char *src, std::size_t n,
+			   unsigned char *dst, std::size_t dstn)
+    {
+      using namespace detail;
+      const unsigned char *ip = src, *iend = src + n;
+      unsigned char *op = dst, *oend = dst + dstn;
+      while (ip < iend) {
+	unsigned token = *ip++;
+	std::size_t nliteral = token >> 4;
+	if (nliteral == 15) {
+	  nliteral += read_length(ip, iend);
+	}
+	if (nliteral > static_cast<std::size_t>(iend - ip)
+	    or nliteral > static_cast<std::size_t>(oend - op)) {
+	  throw std::runtime_error("lz::decompress: literal run out of bounds");
+	}
+	if (nliteral) {
+	  std::memcpy(op, ip, nliteral);
+	}
+	ip += nliteral;
+	op += nliteral;
+	if (ip == iend) {
+	  break; /* final sequence has no match */
+	}
+	if (iend - ip < 2) {
+	  throw std::runtime_error("lz::decompress: truncated offset");
+	}
+	std::size_t offset = ip[0] | (std::size_t{ip[1]} << 8);
+	ip += 2;
+	std::size_t len = token & 0xf;
+	if (len == 15) {
+	  len += read_length(ip, iend);
+	}
+	len += min_match;
+	if (offset == 0 or offset > static_cast<std::size_t>(op - dst)
+	    or len > static_cast<std::size_t>(oend - op)) {
+	  throw std::runtime_error("lz::decompress: match out of bounds");
+	}
+	const unsigned char *match = op - offset;
+	/* matches may overlap their own output, so copy forwards bytewise */
+	for (std::size_t i = 0; i < len; ++i) {
+	  op[i] = match[i];
+	}
+	op += len;
+      }
+      if (op != oend) {
+	throw std::runtime_error("lz::decompress: size mismatch");
+      }
+    }
+  } /* namespace lz */
+} /* namespace bits */
+#endif /* BITS_LZ_CODEC_H */
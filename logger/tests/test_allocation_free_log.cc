@@ -0,0 +1,249 @@
+#include "logger.h"
+#include <cstdlib>
+#include <new>
+
+/* counts every allocation made through the global operator new, which is what
+   std::allocator (and so every std::string and std::vector) ends up using */
+static std::size_t allocations = 0;
+/* when set, every allocation fails, to check that the storage survives it */
+static bool fail_allocations = false;
+
+void *operator new(std::size_t size)
+{
+  ++allocations;
+  if (fail_allocations) {
+    throw std::bad_alloc();
+  }
+  if (void *p = std::malloc(size ? size : 1)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+  std::free(p);
+}
+
+/* every call comes from the same call site, so for loggers wider than a
+   byte only the first one has to convert the file and function names */
+template<typename logger_type>
+std::size_t count_allocations(logger_type& logger,
+			      typename logger_type::string_view_type message,
+			      std::size_t ncall)
+{
+  auto before = allocations;
+  for (std::size_t i=0; i<ncall; ++i) {
+    logger.log(message, bits::log_level::WARNING, false);
+  }
+  return allocations - before;
+}
+
+/* logs from a call site with non-ASCII file and function names and checks
+   that the stored entry is exactly the transcoded prefix plus the message */
+template<typename logger_type>
+bool round_trips(logger_type& logger,
+		 typename logger_type::string_view_type message)
+{
+  constexpr auto site = bits::source_location::current(
+    "/src/caf\xc3\xa9/logger.cc", "na\xc3\xafve_handler()", 7);
+  logger.log(message, bits::log_level::WARNING, false, site);
+  auto expected = bits::transcode::from_utf8<typename logger_type::string_type>(
+    "[/src/caf\xc3\xa9/logger.cc:7] (in function na\xc3\xafve_handler()) WARNING:root:");
+  expected += message;
+  return std::get<0>(*logger.rbegin()) == expected;
+}
+
+/* the same checks for every character type the loggers support */
+template<typename logger_type>
+bool check_logger(typename logger_type::string_view_type name,
+		  typename logger_type::string_view_type message,
+		  const char *what)
+{
+  constexpr std::size_t ncall = 100;
+  logger_type logger;
+  logger.set_name(typename logger_type::string_type(name))
+    .set_level(bits::log_level::INFO);
+  count_allocations(logger, message, 1);
+  auto used = count_allocations(logger, message, ncall);
+  bool ok = round_trips(logger, message);
+  /* one-byte loggers use the call site's names as they are, so even the
+     first call from a new site doesn't allocate */
+  constexpr auto new_site = bits::source_location::current(
+    "/src/new_site.cc", "first_call()", 1);
+  auto before = allocations;
+  logger.log(message, bits::log_level::WARNING, false, new_site);
+  bool first_call_free = sizeof(typename logger_type::char_type) != 1
+    or allocations - before == 0;
+  std::cout << ncall << " calls to " << what << ".log() made " << used
+	    << " allocations, entries " << (ok ? "round-trip" : "DON'T round-trip")
+	    << '\n';
+  return used == 0 and ok and first_call_free;
+}
+
+/* a stream buffer over a fixed array that starts over from the beginning
+   when it fills up, so writing to it never allocates */
+class fixed_buffer : public std::streambuf
+{
+  char m_buf[4096];
+
+protected:
+  int_type overflow(int_type c) override
+  {
+    setp(m_buf, m_buf + sizeof(m_buf));
+    if (not traits_type::eq_int_type(c, traits_type::eof())) {
+      sputc(traits_type::to_char_type(c));
+    }
+    return traits_type::not_eof(c);
+  }
+
+public:
+  fixed_buffer()
+  {
+    setp(m_buf, m_buf + sizeof(m_buf));
+  }
+};
+
+/* makes sealing fail when the first and third segments fill up, and checks
+   that the failed writes leave no trace and every other entry reads back */
+bool survives_failed_seals()
+{
+  bits::in_memory_storage backing(0, 8);
+  auto time = bits::in_memory_storage::clock_type::now();
+  std::vector<std::string> written;
+  for (std::size_t i=0; i<40; ++i) {
+    std::string message = "entry number " + std::to_string(i);
+    fail_allocations = (i == 7 or i == 23);
+    try {
+      backing.write(message, bits::log_level::INFO, time);
+      fail_allocations = false;
+      written.push_back(message);
+    } catch (const std::bad_alloc&) {
+      fail_allocations = false;
+      /* the write failed as a whole, so retrying it has to work */
+      if (backing.size() != written.size()) {
+	return false;
+      }
+      backing.write(message, bits::log_level::INFO, time);
+      written.push_back(message);
+    }
+  }
+  if (backing.size() != written.size() or backing.num_sealed_segments() != 5) {
+    return false;
+  }
+  std::size_t i=0;
+  for (auto entry : backing) {
+    if (std::get<0>(entry) != written[i++]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  constexpr std::size_t ncall = 100;
+  bits::basic_logger<char> logger;
+  logger.set_name("root").set_level(bits::log_level::INFO);
+  /* the first round allocates the active segment's slots */
+  count_allocations(logger, "a short message", 1);
+  auto used = count_allocations(logger, "a short message", ncall);
+  std::cout << ncall << " calls to log() made " << used << " allocations\n";
+  if (used != 0) {
+    return 1;
+  }
+
+  if (not check_logger<bits::logger>("root", "a short message", "logger")
+      or not check_logger<bits::wlogger>(L"root", L"a short message", "wlogger")
+      or not check_logger<bits::u8logger>(u8"root", u8"a short message", "u8logger")
+      or not check_logger<bits::u16logger>(u"root", u"a short message", "u16logger")
+      or not check_logger<bits::u32logger>(U"root", U"a short message", "u32logger")) {
+    return 1;
+  }
+
+  /* sealing a full segment allocates the compressed copy of it (and now and
+     then grows the list of segments), but nothing else. The first seal also
+     sizes the buffers a segment is serialized and compressed in, so cross
+     one before counting. */
+  constexpr std::size_t segment = bits::in_memory_storage::default_segment_entries;
+  count_allocations(logger, "a short message", segment);
+  std::size_t nseal = 10;
+  used = count_allocations(logger, "a short message", nseal * segment);
+  std::cout << nseal * segment << " calls to log() across " << nseal
+	    << " seals made " << used << " allocations\n";
+  if (used > 2 * nseal) {
+    return 1;
+  }
+
+  /* entries are packed into the active segment, so a call site whose prefix
+     alone is longer than inline_chars() (an absolute path and a long
+     function name, say) still doesn't allocate as long as the entries
+     around it are shorter */
+  constexpr auto long_site = bits::source_location::current(
+    "/home/builder/work/projects/bits/build/release/../../logger/tests/"
+    "subsystems/networking/transport/test_allocation_free_log.cc",
+    "void bits::tests::networking::transport::connection_manager::"
+    "handle_incoming_request_with_retry_and_backoff()", 1234);
+  bits::logger packed;
+  packed.set_name("root")
+    .set_backing(std::make_shared<bits::logger::backing_type>(0, 512, 192));
+  packed.log("warming up", bits::log_level::INFO, false, long_site);
+  auto before = allocations;
+  for (std::size_t i=0; i<ncall; ++i) {
+    packed.log("a message from a long call site", bits::log_level::INFO,
+	       false, long_site);
+    packed.log("short", bits::log_level::INFO, false);
+  }
+  used = allocations - before;
+  auto long_entry = std::get<0>(*(packed.rbegin() + 1));
+  std::cout << 2 * ncall << " calls to log() with " << long_entry.size()
+	    << " character entries made " << used << " allocations\n";
+  if (long_entry.size() <= 192
+      or long_entry.find("handle_incoming_request_with_retry_and_backoff") == std::string::npos
+      or used != 0) {
+    return 1;
+  }
+
+  /* displaying an entry formats it into buffers the logger keeps, so once
+     they (and the time zone localtime() loads) are set up it's free too */
+  fixed_buffer display_buffer;
+  std::ostream display(&display_buffer);
+  bits::logger shown(display);
+  shown.set_name("root").set_level(bits::log_level::INFO);
+  shown.log("a short message", bits::log_level::WARNING);
+  before = allocations;
+  for (std::size_t i=0; i<ncall; ++i) {
+    shown.log("a short message", bits::log_level::WARNING);
+  }
+  used = allocations - before;
+  std::cout << ncall << " displayed calls to log() made " << used
+	    << " allocations\n";
+  if (used != 0 or not display) {
+    return 1;
+  }
+
+  /* an entry too long for what's left of the active segment spills to the
+     overflow area, but still reads back intact */
+  std::string long_message(bits::in_memory_storage::default_segment_entries
+			   * bits::in_memory_storage::default_inline_chars, 'x');
+  logger.log(long_message, bits::log_level::ERROR, false);
+  auto last = std::get<0>(*logger.rbegin());
+  if (last.size() < long_message.size()
+      or last.compare(last.size() - long_message.size(), long_message.size(), long_message) != 0) {
+    std::cout << "long message did not round-trip\n";
+    return 1;
+  }
+  std::cout << "long message round-tripped through the overflow area\n";
+
+  if (not survives_failed_seals()) {
+    std::cout << "a failed seal corrupted the storage\n";
+    return 1;
+  }
+  std::cout << "failed seals left the storage intact\n";
+  return 0;
+}
@@ -19,6 +19,114 @@ void test_in_memory_storage(const std::vector<std::string>& entries,
   }
 }
 
+/* throws unless the messages take at least `min_ratio` times the memory the
+   storage is actually holding on to */
+template<typename storage>
+void check_compression_ratio(const storage& backing, double min_ratio,
+			     const char *when)
+{
+  double ratio = double(backing.buffer_size()) / backing.resident_size();
+  std::cout << when << ": messages take " << backing.buffer_size()
+	    << " bytes, " << backing.resident_size() << " bytes resident ("
+	    << ratio << "x)\n";
+  if (ratio < min_ratio) {
+    throw std::runtime_error(std::string{"compression ratio too low "} + when);
+  }
+}
+
+/* writes enough entries to seal several compressed segments, then checks that
+   iteration and read() give back exactly what was written without leaving
+   decompressed segments resident */
+template<typename storage>
+void test_segment_compression(std::size_t nentry, double min_ratio,
+			      storage backing)
+{
+  std::vector<typename storage::entry_type> written;
+  auto time = storage::clock_type::now();
+  for (std::size_t i=0; i<nentry; ++i) {
+    auto level = i % 3 ? bits::log_level::INFO : bits::log_level::WARNING;
+    std::string message = "[test_in_memory_storage.cc:42] (in function main) "
+      + std::string(level == bits::log_level::INFO ? "INFO" : "WARNING")
+      + ":root:processed request number " + std::to_string(i);
+    backing.write(message, level, time + std::chrono::milliseconds(i));
+    written.push_back({message, level, time + std::chrono::milliseconds(i)});
+  }
+  std::cout << "wrote " << backing.size() << " entries into "
+	    << backing.num_sealed_segments() << " sealed segments\n";
+  if (backing.size() != nentry) {
+    throw std::runtime_error("size() does not match the number of entries written");
+  }
+  check_compression_ratio(backing, min_ratio, "after writing");
+  std::size_t i=0;
+  for (auto entry : backing) {
+    if (entry != written[i++]) {
+      throw std::runtime_error("entry " + std::to_string(i-1) + " did not round-trip");
+    }
+  }
+  for (auto entry = backing.rbegin(); entry != backing.rend(); ++entry) {
+    if (*entry != written[--i]) {
+      throw std::runtime_error("entry " + std::to_string(i) + " did not round-trip in reverse");
+    }
+  }
+  auto cached = backing.resident_size();
+  backing.release_cache();
+  if (backing.resident_size() >= cached) {
+    throw std::runtime_error("release_cache() did not free the decompressed segments");
+  }
+  check_compression_ratio(backing, min_ratio, "after iterating");
+  std::string expected;
+  for (i=0; i<nentry; ++i) {
+    expected += backing.formatted_entry(std::get<0>(written[i]),
+					std::get<1>(written[i]),
+					std::get<2>(written[i]));
+    if (i + 1 < nentry) {
+      expected += backing.new_line();
+    }
+  }
+  if (backing.read() != expected) {
+    throw std::runtime_error("read() does not match the entries written");
+  }
+  check_compression_ratio(backing, min_ratio, "after read()");
+
+  /* const access decompresses into the shared cache, which has to stay
+     consistent when several threads read at once */
+  auto reader = [&]() {
+    for (std::size_t pass=0; pass<4; ++pass) {
+      std::size_t j=0;
+      for (auto entry : backing) {
+	if (entry != written[j++]) {
+	  throw std::runtime_error("entry " + std::to_string(j-1) + " differed in a concurrent read");
+	}
+      }
+    }
+  };
+  std::thread first(reader), second(reader);
+  first.join();
+  second.join();
+}
+
+/* one oversized entry grows the buffers a segment is built in; once it has
+   been sealed, that memory has to be given back */
+template<typename storage>
+void test_oversized_entry(double min_ratio, storage backing)
+{
+  std::string dump;
+  while (dump.size() < 4 * 1024 * 1024) {
+    dump += "0x" + std::to_string(dump.size()) + ": 00 00 00 00 de ad be ef\n";
+  }
+  auto time = storage::clock_type::now();
+  backing.write(dump, bits::log_level::ERROR, time);
+  for (std::size_t i=0; i<40 * backing.segment_entries(); ++i) {
+    backing.write("processed request number " + std::to_string(i),
+		  bits::log_level::INFO, time);
+  }
+  if (std::get<0>(*backing.begin()) != dump) {
+    throw std::runtime_error("oversized entry did not round-trip");
+  }
+  backing.release_cache();
+  check_compression_ratio(backing, min_ratio, "after an oversized entry");
+}
+
 int main(int argc, char **argv)
 {
   bits::in_memory_storage backing;
@@ -26,6 +134,9 @@ int main(int argc, char **argv)
   std::vector<std::string> entries{{"a debug message"}, {"a warning message"}, {"an unset message"}};
   std::vector<bits::log_level> levels{bits::log_level::DEBUG, bits::log_level::WARNING, bits::log_level::NOTSET};
   test_in_memory_storage(entries, levels, backing);
+  test_segment_compression(20000, 5.0, bits::in_memory_storage{});
+  test_segment_compression(1000, 2.5, bits::in_memory_storage{0, 64, 96});
+  test_oversized_entry(5.0, bits::in_memory_storage{});
   bits::basic_logger<char> logger;
   return 0;
 }
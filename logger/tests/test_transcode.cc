@@ -0,0 +1,44 @@
+#include "transcode.h"
+#include <iostream>
+#include <stdexcept>
+
+template<typename String>
+void check(std::string_view in, const String& expected, const char *what)
+{
+  if (bits::transcode::from_utf8<String>(in) != expected) {
+    throw std::runtime_error(std::string{"transcoding failed: "} + what);
+  }
+  std::cout << what << ": ok\n";
+}
+
+int main(int argc, char **argv)
+{
+  /* long enough to go through the vectorized ASCII path more than once, with
+     a tail that doesn't fill a whole vector */
+  std::string ascii;
+  for (int i=0; i<100; ++i) {
+    ascii += static_cast<char>(' ' + i % 95);
+  }
+  check(ascii, std::u16string(ascii.begin(), ascii.end()), "ASCII to UTF-16");
+  check(ascii, std::u32string(ascii.begin(), ascii.end()), "ASCII to UTF-32");
+  check(ascii, std::wstring(ascii.begin(), ascii.end()), "ASCII to wide");
+  check(ascii, std::u8string(ascii.begin(), ascii.end()), "ASCII to UTF-8");
+
+  /* non-ASCII in the middle of a vector's worth of ASCII */
+  std::string mixed = "caf\xc3\xa9 na\xc3\xafve \xe2\x82\xac 100 \xf0\x9f\x93\x9c log entry";
+  check(mixed, std::u16string(u"café naïve € 100 \U0001F4DC log entry"),
+	"mixed to UTF-16");
+  check(mixed, std::u32string(U"café naïve € 100 \U0001F4DC log entry"),
+	"mixed to UTF-32");
+
+  /* one U+FFFD per maximal subpart: a stray continuation byte is one, an
+     overlong encoding and a surrogate are one per byte (no prefix of them is
+     valid), and a truncated sequence, whether cut off by the end of the
+     input or by another byte, is one for the whole valid prefix */
+  std::string invalid = "a\x80" "b\xc0\xaf" "c\xed\xa0\x80" "d\xf0\x9f\x93" "e\xe2\x82";
+  check(invalid, std::u32string(U"a\uFFFDb\uFFFD\uFFFDc\uFFFD\uFFFD\uFFFDd\uFFFDe\uFFFD"),
+	"invalid to UTF-32");
+  check(invalid, std::u16string(u"a\uFFFDb\uFFFD\uFFFDc\uFFFD\uFFFD\uFFFDd\uFFFDe\uFFFD"),
+	"invalid to UTF-16");
+  return 0;
+}
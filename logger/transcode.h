@@ -0,0 +1,230 @@
+#ifndef BITS_TRANSCODE_H
+#define BITS_TRANSCODE_H
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <type_traits>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace bits
+{
+  /* conversion of narrow (UTF-8) strings, like the ones in source_location
+     and the output of strftime, into any of the character types the loggers
+     support. Code units are 1 byte wide for char and char8_t (copied as-is),
+     2 for char16_t (UTF-16) and 4 for char32_t (UTF-32); wchar_t is treated
+     as whichever of those matches its size. */
+  namespace transcode
+  {
+    namespace detail
+    {
+      /* widens the leading run of ASCII bytes in [in, in+n) into `out`, and
+	 returns how many bytes it consumed */
+      template<class CharT>
+      std::size_t widen_ascii(const unsigned char *in, std::size_t n, CharT *out) noexcept
+      {
+	std::size_t i = 0;
+#if defined(__AVX2__)
+	for (; i + 32 <= n; i += 32) {
+	  __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + i));
+	  if (_mm256_movemask_epi8(v)) {
+	    break;
+	  }
+	  if constexpr (sizeof(CharT) == 1) {
+	    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), v);
+	  } else if constexpr (sizeof(CharT) == 2) {
+	    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i),
+				_mm256_cvtepu8_epi16(_mm256_castsi256_si128(v)));
+	    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i + 16),
+				_mm256_cvtepu8_epi16(_mm256_extracti128_si256(v, 1)));
+	  } else {
+	    for (std::size_t k = 0; k < 32; k += 8) {
+	      __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(in + i + k));
+	      _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i + k),
+				  _mm256_cvtepu8_epi32(bytes));
+	    }
+	  }
+	}
+#elif defined(__SSE2__)
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 16 <= n; i += 16) {
+	  __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+	  if (_mm_movemask_epi8(v)) {
+	    break;
+	  }
+	  if constexpr (sizeof(CharT) == 1) {
+	    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), v);
+	  } else if constexpr (sizeof(CharT) == 2) {
+	    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm_unpacklo_epi8(v, zero));
+	    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i + 8), _mm_unpackhi_epi8(v, zero));
+	  } else {
+	    __m128i lo = _mm_unpacklo_epi8(v, zero), hi = _mm_unpackhi_epi8(v, zero);
+	    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm_unpacklo_epi16(lo, zero));
+	    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i + 4), _mm_unpackhi_epi16(lo, zero));
+	    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i + 8), _mm_unpacklo_epi16(hi, zero));
+	    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i + 12), _mm_unpackhi_epi16(hi, zero));
+	  }
+	}
+#endif
+	for (; i < n and in[i] < 0x80; ++i) {
+	  out[i] = static_cast<CharT>(in[i]);
+	}
+	return i;
+      }
+
+      /* decodes the (non-ASCII) sequence starting at in[i] and advances i
+	 past it. Malformed input decodes to one U+FFFD per maximal subpart,
+	 i.e. a valid but incomplete prefix of a sequence is replaced as a
+	 whole, and any other bad byte on its own. */
+      inline char32_t decode_utf8(const unsigned char *in, std::size_t n,
+				  std::size_t& i) noexcept
+      {
+	constexpr char32_t replacement = 0xfffd;
+	unsigned char lead = in[i];
+	std::size_t len;
+	char32_t cp;
+	unsigned char lo = 0x80, hi = 0xbf;
+	if (lead >= 0xc2 and lead <= 0xdf) {
+	  len = 2;
+	  cp = lead & 0x1f;
+	} else if (lead >= 0xe0 and lead <= 0xef) {
+	  len = 3;
+	  cp = lead & 0x0f;
+	  lo = lead == 0xe0 ? 0xa0 : 0x80;
+	  hi = lead == 0xed ? 0x9f : 0xbf;
+	} else if (lead >= 0xf0 and lead <= 0xf4) {
+	  len = 4;
+	  cp = lead & 0x07;
+	  lo = lead == 0xf0 ? 0x90 : 0x80;
+	  hi = lead == 0xf4 ? 0x8f : 0xbf;
+	} else {
+	  ++i;
+	  return replacement;
+	}
+	for (std::size_t k = 1; k < len; ++k) {
+	  if (i + k == n or in[i + k] < lo or in[i + k] > hi) {
+	    i += k;
+	    return replacement;
+	  }
+	  cp = (cp << 6) | (in[i + k] & 0x3f);
+	  lo = 0x80;
+	  hi = 0xbf;
+	}
+	i += len;
+	return cp;
+      }
+
+      template<class CharT>
+      CharT *encode(char32_t cp, CharT *out) noexcept
+      {
+	if constexpr (sizeof(CharT) == 2) {
+	  if (cp >= 0x10000) {
+	    cp -= 0x10000;
+	    *out++ = static_cast<CharT>(0xd800 + (cp >> 10));
+	    *out++ = static_cast<CharT>(0xdc00 + (cp & 0x3ff));
+	    return out;
+	  }
+	}
+	*out++ = static_cast<CharT>(cp);
+	return out;
+      }
+    } /* namespace detail */
+
+    /* converts the ASCII string [in, in+n) into `out`, which must have room
+       for n code units, and returns the number of code units written */
+    template<class CharT>
+    std::size_t widen_ascii(const char *in, std::size_t n, CharT *out) noexcept
+    {
+      return detail::widen_ascii(reinterpret_cast<const unsigned char *>(in), n, out);
+    }
+
+    /* appends the UTF-8 string `in` to `out`, converted to out's encoding */
+    template<class CharT, class Traits, class Alloc>
+    void append_utf8(std::basic_string<CharT, Traits, Alloc>& out, std::string_view in)
+    {
+      if constexpr (sizeof(CharT) == 1) {
+	out.append(reinterpret_cast<const CharT *>(in.data()), in.size());
+      } else {
+	/* every code unit produced consumes at least one byte of input */
+	auto start = out.size();
+	out.resize(start + in.size());
+	CharT *dest = out.data() + start;
+	auto p = reinterpret_cast<const unsigned char *>(in.data());
+	std::size_t n = in.size(), i = 0;
+	while (i < n) {
+	  std::size_t nascii = detail::widen_ascii(p + i, n - i, dest);
+	  i += nascii;
+	  dest += nascii;
+	  if (i < n) {
+	    dest = detail::encode(detail::decode_utf8(p, n, i), dest);
+	  }
+	}
+	out.resize(dest - out.data());
+      }
+    }
+
+    template<class String>
+    String from_utf8(std::string_view in)
+    {
+      String out;
+      append_utf8(out, in);
+      return out;
+    }
+
+    /* converts a string with static storage duration, such as the file and
+       function names in a source_location, once per thread and returns a
+       view of the converted copy on every later call. Strings are looked up
+       by address, so `s` must not be a buffer that is reused. For one-byte
+       character types the view is of `s` itself. */
+    template<class String>
+    std::basic_string_view<typename String::value_type, typename String::traits_type>
+    call_site(const char *s)
+    {
+      using view_type = std::basic_string_view<typename String::value_type,
+					       typename String::traits_type>;
+      if constexpr (sizeof(typename String::value_type) == 1) {
+	return view_type(reinterpret_cast<const typename String::value_type *>(s));
+      } else {
+	static thread_local std::unordered_map<const char *, String> cache;
+	auto it = cache.find(s);
+	if (it == cache.end()) {
+	  it = cache.emplace(s, from_utf8<String>(s)).first;
+	}
+	return view_type(it->second);
+      }
+    }
+
+    /* an ASCII string literal widened to CharT at compile time */
+    template<class CharT, std::size_t N>
+    struct ascii_literal
+    {
+      CharT data[N];
+
+      constexpr ascii_literal(const char (&s)[N]) noexcept
+	: data{}
+      {
+	for (std::size_t i = 0; i < N; ++i) {
+	  data[i] = static_cast<CharT>(s[i]);
+	}
+      }
+
+      template<class Traits>
+      constexpr operator std::basic_string_view<CharT, Traits>() const noexcept
+      {
+	return std::basic_string_view<CharT, Traits>(data, N - 1);
+      }
+    };
+
+    template<class CharT, std::size_t N>
+    constexpr ascii_literal<CharT, N> literal(const char (&s)[N]) noexcept
+    {
+      return ascii_literal<CharT, N>(s);
+    }
+  } /* namespace transcode */
+} /* namespace bits */
+#endif /* BITS_TRANSCODE_H */